@@ -0,0 +1,56 @@
+#include "../include/fbtt.hpp"
+
+#include <algorithm>
+#include <random>
+
+using namespace fbtt;
+
+std::vector<int> randomVector(size_t n)
+{
+   static std::mt19937 random { 1 };
+   std::vector<int> v(n);
+   for (int & x : v)
+      x = static_cast<int>(random());
+   return v;
+}
+
+int main()
+{
+   MultiTest<std::vector<int>> complexityTest { "Complexity of vector algorithms" };
+
+   complexityTest.addTest(
+      "std::sort is O(n log n)", [](auto&) {
+         assertScalesAs(Complexity::N_LOG_N, randomVector, [](std::vector<int>& v) {
+            std::sort(v.begin(), v.end());
+         });
+      }
+   );
+
+   complexityTest.addTest(
+      "size() is O(1)", [](auto&) {
+         assertScalesAs(Complexity::CONSTANT, randomVector, [](std::vector<int>& v) {
+            size_t size = v.size();
+            doNotOptimize(size);
+         });
+      }
+   );
+
+   // inserting at the front moves every element, so copying n elements this way is O(n^2)
+   complexityTest.addTest(
+      "copy by inserting at the front is O(n log n) (fails)", [](auto&) {
+         assertScalesAs(Complexity::N_LOG_N, randomVector, [](std::vector<int>& v) {
+            std::vector<int> copy;
+            for (int x : v)
+               copy.insert(copy.begin(), x);
+            doNotOptimize(copy);
+         });
+      }
+   );
+
+   std::cout << "Running tests...\n";
+   complexityTest.run();
+
+   std::cout << complexityTest;
+
+   return getErrorCode(complexityTest.getResults());
+}
@@ -0,0 +1,135 @@
+#include "../include/fbtt.hpp"
+
+#include <mutex>
+
+using namespace fbtt;
+
+// Counter with a lost update: two threads can load the same value, and both store value + 1.
+struct RacyCounter {
+   Atomic<int> value { 0 };
+
+   void increment() { value.store(value.load() + 1); }
+};
+
+struct LockedCounter {
+   Mutex mutex;
+   int value = 0;
+
+   void increment()
+   {
+      std::lock_guard<Mutex> lock { mutex };
+      value++;
+   }
+};
+
+// Two accounts, each with its own mutex. A transfer locks the source first, so transfers in opposite directions can deadlock.
+struct Accounts {
+   Mutex mutexA, mutexB;
+   int a = 100, b = 100;
+};
+
+// One thread writes data and sets a flag, the other spins on the flag, and reads data.
+struct Handoff {
+   Atomic<bool> ready { false };
+   int data = 0;
+   int received = 0;
+};
+
+int main()
+{
+   MultiTest<RacyCounter> racyTest { "Counter with lost update" };
+
+   auto racyIncrement = [](RacyCounter& counter) { counter.increment(); };
+   auto racyCheck = [](RacyCounter& counter) { assertEquals(counter.value.load(), 2); };
+
+   racyTest.addInterleavingTest(
+      "two increments give 2 (fails)", { racyIncrement, racyIncrement }, racyCheck
+   );
+
+   // the options reported by the failing test replay exactly the failing schedule
+   racyTest.addInterleavingTest(
+      "replay by seed (fails)", { racyIncrement, racyIncrement }, racyCheck,
+      { .schedules = 1, .seed = 3, .pctSteps = 3 }
+   );
+
+   racyTest.addInterleavingTest(
+      "replay by schedule (fails)", { racyIncrement, racyIncrement }, racyCheck,
+      { .replay = "1*2,0*3" }
+   );
+
+   // there are few interleavings of three increments, so every one of them is explored
+   racyTest.addInterleavingTest(
+      "exhaustive with atomic increments", {
+         [](RacyCounter& counter) { counter.value++; },
+         [](RacyCounter& counter) { counter.value++; },
+         [](RacyCounter& counter) { counter.value++; }
+      },
+      [](RacyCounter& counter) { assertEquals(counter.value.load(), 3); },
+      { .strategy = InterleavingStrategy::EXHAUSTIVE }
+   );
+
+   MultiTest<LockedCounter> lockedTest { "Counter with mutex" };
+
+   auto lockedIncrement = [](LockedCounter& counter) { counter.increment(); };
+   lockedTest.addInterleavingTest(
+      "three increments give 3", { lockedIncrement, lockedIncrement, lockedIncrement },
+      [](LockedCounter& counter) { assertEquals(counter.value, 3); }
+   );
+
+   MultiTest<Accounts> accountsTest { "Transfers between accounts" };
+
+   accountsTest.addInterleavingTest(
+      "transfers in opposite directions (deadlocks)", {
+         [](Accounts& accounts) {
+            std::lock_guard<Mutex> from { accounts.mutexA };
+            std::lock_guard<Mutex> to { accounts.mutexB };
+            accounts.a -= 10;
+            accounts.b += 10;
+         },
+         [](Accounts& accounts) {
+            std::lock_guard<Mutex> from { accounts.mutexB };
+            std::lock_guard<Mutex> to { accounts.mutexA };
+            accounts.b -= 20;
+            accounts.a += 20;
+         }
+      },
+      [](Accounts& accounts) { assertEquals(accounts.a + accounts.b, 200); }
+   );
+
+   MultiTest<Handoff> handoffTest { "Handoff with spin-wait" };
+
+   auto writer = [](Handoff& handoff) {
+      handoff.data = 42;
+      handoff.ready.store(true);
+   };
+   auto reader = [](Handoff& handoff) {
+      while (!handoff.ready.load()) { }
+      handoff.received = handoff.data;
+   };
+   auto handoffCheck = [](Handoff& handoff) { assertEquals(handoff.received, 42); };
+
+   // after maxStreak yield points in a row, PCT lowers the priority of the spinning reader, so the writer gets to set the flag
+   handoffTest.addInterleavingTest(
+      "reader sees data after flag", { writer, reader }, handoffCheck, { .maxSteps = 1000 }
+   );
+
+   // the reader is thread 0, which EXHAUSTIVE runs first. After maxStreak yield points in a row, it runs the writer instead
+   handoffTest.addInterleavingTest(
+      "reader sees data after flag, exhaustive", { reader, writer }, handoffCheck,
+      { .strategy = InterleavingStrategy::EXHAUSTIVE, .maxSteps = 1000 }
+   );
+
+   std::cout << "Running tests...\n";
+   racyTest.run();
+   lockedTest.run();
+   accountsTest.run();
+   handoffTest.run();
+
+   std::cout << racyTest << lockedTest << accountsTest << handoffTest;
+
+   for (int code : { getErrorCode(racyTest.getResults()), getErrorCode(lockedTest.getResults()),
+                     getErrorCode(accountsTest.getResults()), getErrorCode(handoffTest.getResults()) })
+      if (code != 0)
+         return code;
+   return 0;
+}
@@ -0,0 +1,66 @@
+#include "../include/fbtt.hpp"
+
+#include <atomic>
+#include <mutex>
+
+using namespace fbtt;
+
+// Compare how a lock-based and a lock-free counter scale with the number of threads.
+struct Counter {
+   virtual void increment() = 0;
+   virtual long value() = 0;
+   virtual ~Counter() { };
+};
+
+struct LockedCounter : public Counter {
+   std::mutex mutex;
+   long count = 0;
+
+   void increment() { std::lock_guard<std::mutex> lock { mutex }; count++; }
+   long value() { std::lock_guard<std::mutex> lock { mutex }; return count; }
+};
+
+struct AtomicCounter : public Counter {
+   std::atomic<long> count { 0 };
+
+   void increment() { count.fetch_add(1, std::memory_order_relaxed); }
+   long value() { return count.load(); }
+};
+
+int main()
+{
+   MultiTest<Counter> counterTest { "Scaling of counters" };
+
+   counterTest.addConstructor(
+      "Lock-based counter", [](Counter*& counter) {
+         counter = new LockedCounter;
+      }
+   );
+
+   counterTest.addConstructor(
+      "Lock-free counter", [](Counter*& counter) {
+         counter = new AtomicCounter;
+      }
+   );
+
+   counterTest.addTest(
+      "increments are counted", [](Counter& counter) {
+         counter.increment();
+         counter.increment();
+         assertEquals(counter.value(), 2L);
+      }
+   );
+
+   counterTest.addScalingBenchmark(
+      "increment", [](Counter& counter) {
+         counter.increment();
+      }, { .operations = 1 << 22 }
+   );
+
+   std::cout << "Running tests...\n";
+   counterTest.run();
+
+   std::cout << counterTest;
+
+   return getErrorCode(counterTest.getResults());
+}
@@ -0,0 +1,38 @@
+#include "../include/fbtt.hpp"
+#include "../include/fuzz.hpp"
+
+using namespace fbtt;
+
+// Fuzz std::vector<int> against its own invariants.
+// Build for fuzzing with:   clang++ -std=c++20 -DFBTT_FUZZING -fsanitize=fuzzer,address vectorFuzz.cpp
+// Replay a saved corpus with a normal build:   ./vectorFuzz corpus/
+FuzzTarget<std::vector<int>> & vectorFuzzTarget()
+{
+   static MultiTest<std::vector<int>> vectorTest { "Fuzz of std::vector" };
+
+   static FuzzTarget<std::vector<int>> target {
+      vectorTest, [](FuzzInput & input, auto & vec) {
+         while (input.remaining() > 0) {
+            switch (input.consumeInRange(0, 2)) {
+               case 0:
+                  vec.push_back(input.consume<int>());
+                  break;
+               case 1:
+                  if (!vec.empty())
+                     vec.pop_back();
+                  break;
+               case 2:
+                  vec.resize(input.consumeInRange<size_t>(0, 64));
+                  break;
+            }
+            assertTrue(vec.size() <= vec.capacity(), "Vector size is larger than capacity");
+         }
+      }
+   };
+
+   // start over from an empty vector now and then, so the vector doesn't grow forever
+   target.rebuildEvery(1000);
+   return target;
+}
+
+FBTT_FUZZ_TARGET(vectorFuzzTarget)
@@ -53,6 +53,12 @@ namespace fbtt {
       }
    };
 
+   struct ComplexityAssertionFailure : public AssertionFailure {
+      ComplexityAssertionFailure(const std::string & msg)
+         : AssertionFailure { msg + " (complexity assertion)" }
+      { };
+   };
+
    template <typename Error>
    struct ThrowingAssertionFailure : public AssertionFailure {
       ThrowingAssertionFailure()
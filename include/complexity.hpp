@@ -0,0 +1,244 @@
+#pragma once
+
+#include "assertionFailure.hpp"
+#include "functionConcepts.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fbtt {
+   /** Complexity classes, that a measured running time can be fitted to. Ordered from best to worst. */
+   enum class Complexity {
+      CONSTANT,
+      LOG_N,
+      N,
+      N_LOG_N,
+      N_SQUARED,
+      N_CUBED
+   };
+
+   /** @returns Big-O notation for the complexity class, e.g. "O(n log n)". */
+   std::string complexityName(Complexity complexity)
+   {
+      switch (complexity) {
+         case Complexity::CONSTANT:
+            return "O(1)";
+         case Complexity::LOG_N:
+            return "O(log n)";
+         case Complexity::N:
+            return "O(n)";
+         case Complexity::N_LOG_N:
+            return "O(n log n)";
+         case Complexity::N_SQUARED:
+            return "O(n^2)";
+         case Complexity::N_CUBED:
+            return "O(n^3)";
+         default:
+            return "O(?)";
+      };
+   }
+
+   /** @returns The value of the complexity function for input size n. */
+   double complexityFunction(Complexity complexity, double n)
+   {
+      switch (complexity) {
+         case Complexity::CONSTANT:
+            return 1.0;
+         case Complexity::LOG_N:
+            return std::log2(n);
+         case Complexity::N:
+            return n;
+         case Complexity::N_LOG_N:
+            return n * std::log2(n);
+         case Complexity::N_SQUARED:
+            return n * n;
+         case Complexity::N_CUBED:
+            return n * n * n;
+         default:
+            return 1.0;
+      };
+   }
+
+   /** Result of fitting measured times to every complexity class.
+    * @param best: The complexity class with the lowest fitting error
+    * @param intercept: Intercept of the best fit, such that time ~= intercept + coefficient * f(n)
+    * @param coefficient: Coefficient of the best fit
+    * @param errors: Normalized root mean square error of the fit for every complexity class */
+   struct ComplexityFit {
+      Complexity best = Complexity::CONSTANT;
+      double intercept = 0.0;
+      double coefficient = 0.0;
+      std::vector<double> errors;
+   };
+
+   /** Fit the measured times to every complexity class with least squares (time ~= intercept + coefficient * f(n)).
+    * The intercept takes up constant costs, which would otherwise pull the fit towards a lower complexity class.
+    * Intercept and coefficient are never negative. Residuals are relative to the measured time, so every input size weighs equally in the fit.
+    * The error of each fit is the root mean square of the relative residuals.
+    * @param sizes: Input sizes
+    * @param times: Measured time for each input size */
+   ComplexityFit fitComplexity(const std::vector<size_t> & sizes, const std::vector<double> & times)
+   {
+      ComplexityFit fit;
+
+      double bestError = std::numeric_limits<double>::infinity();
+      for (int c = 0; c <= static_cast<int>(Complexity::N_CUBED); c++) {
+         Complexity complexity = static_cast<Complexity>(c);
+
+         // minimize sum (1 - intercept * u_i - coefficient * r_i)^2, where u_i = 1 / t_i and r_i = f(n_i) / t_i
+         double sumU = 0.0, sumR = 0.0, sumUU = 0.0, sumUR = 0.0, sumRR = 0.0;
+         for (size_t i = 0; i < sizes.size(); i++) {
+            double u = 1.0 / times[i];
+            double r = complexityFunction(complexity, sizes[i]) / times[i];
+            sumU += u;
+            sumR += r;
+            sumUU += u * u;
+            sumUR += u * r;
+            sumRR += r * r;
+         }
+
+         double intercept = 0.0, coefficient = sumR / sumRR;
+         double determinant = sumUU * sumRR - sumUR * sumUR;
+         if (determinant > 1e-9 * sumUU * sumRR) {
+            intercept = (sumU * sumRR - sumR * sumUR) / determinant;
+            coefficient = (sumR * sumUU - sumU * sumUR) / determinant;
+            if (intercept < 0.0) {
+               intercept = 0.0;
+               coefficient = sumR / sumRR;
+            } else if (coefficient < 0.0) {
+               intercept = sumU / sumUU;
+               coefficient = 0.0;
+            }
+         }
+
+         double squaredError = 0.0;
+         for (size_t i = 0; i < sizes.size(); i++) {
+            double residual = 1.0 - (intercept + coefficient * complexityFunction(complexity, sizes[i])) / times[i];
+            squaredError += residual * residual;
+         }
+         double error = std::sqrt(squaredError / sizes.size());
+         fit.errors.push_back(error);
+
+         // strictly less: on ties, the lower complexity class is preferred
+         if (error < bestError) {
+            bestError = error;
+            fit.best = complexity;
+            fit.intercept = intercept;
+            fit.coefficient = coefficient;
+         }
+      }
+
+      return fit;
+   }
+
+   /** @returns Input sizes from min to max (inclusive), multiplied by factor at every step. */
+   std::vector<size_t> sizeRange(size_t min, size_t max, size_t factor = 2)
+   {
+      std::vector<size_t> sizes;
+      for (size_t n = std::max<size_t>(min, 1); n <= max; n *= std::max<size_t>(factor, 2))
+         sizes.push_back(n);
+      return sizes;
+   }
+
+   /** @returns Slope of log(values) over log(sizes) for the sizes from index first on: the exponent p, such that values grow as n^p. */
+   double growthExponent(const std::vector<size_t> & sizes, const std::vector<double> & values, size_t first = 0)
+   {
+      double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+      double count = static_cast<double>(sizes.size() - first);
+      for (size_t i = first; i < sizes.size(); i++) {
+         double x = std::log(static_cast<double>(sizes[i]));
+         double y = std::log(values[i]);
+         sumX += x;
+         sumY += y;
+         sumXX += x * x;
+         sumXY += x * y;
+      }
+      return (count * sumXY - sumX * sumY) / (count * sumXX - sumX * sumX);
+   }
+
+   /** Options for assertScalesAs().
+    * @param sizes: Input sizes to measure. Defaults to 64, 128, ..., 8192
+    * @param timing: Options for timing each input size
+    * @param margin: How much larger the fit error of bound (or a better class) may be than the error of the best fit, before the assertion fails.
+    *    Fit errors are relative root mean square errors, so 0.05 is 5%.
+    * @param maxFitError: If no complexity class fits with a smaller error, the measurement is inconclusive, and the assertion fails.
+    * @param exponentTolerance: How much faster than bound the time may grow over the largest half of the sizes (as exponent of n), before the assertion fails.
+    * @param resolution: If the measured times differ by less than this, no growth can be measured, and the assertion passes. */
+   struct ComplexityOptions {
+      std::vector<size_t> sizes = sizeRange(64, 8192);
+      TimingOptions timing = { };
+      double margin = 0.05;
+      double maxFitError = 0.5;
+      double exponentTolerance = 0.25;
+      Nanoseconds resolution = std::chrono::nanoseconds(5);
+   };
+
+   /** Assert that the running time of f grows no faster than the given complexity class.
+    * f is timed on fresh inputs made by generate for every size, and the measured times are fitted to every complexity class.
+    * The growth over the largest sizes, where lower order costs matter least, is checked separately against the growth of bound.
+    * @param bound: The worst complexity class allowed
+    * @param generate: Function with signature Input(size_t n), which makes an input of size n. Not part of the measured time.
+    * @param f: Function with signature void(Input &), which is timed. Every call gets a fresh input.
+    * @param onFail: String for AssertionFailure, if the assertion fails. Defaults to ""
+    * @param options: Input sizes, timing and tolerances of the fit (see ComplexityOptions)
+    * @throws Throws ComplexityAssertionFailure if no complexity class fits the times, if the time grows faster than bound over the largest sizes,
+    *    or if the best fit is worse than bound, and fits clearly better than bound. The message contains the measured times. */
+   template <typename Generator, typename Func>
+      requires CallableWith<Generator, size_t>
+   void assertScalesAs(Complexity bound, Generator generate, Func f, const std::string & onFail = "",
+      const ComplexityOptions & options = { })
+   {
+      const std::vector<size_t> & sizes = options.sizes;
+      if (sizes.size() < 2)
+         throw std::invalid_argument("assertScalesAs needs at least two input sizes.");
+
+      std::vector<double> times;
+      for (size_t n : sizes)
+         times.push_back(measure([&]() { return generate(n); }, f, options.timing).median);
+
+      // below the resolution of the timer, there is no growth to fit
+      auto [fastest, slowest] = std::minmax_element(times.begin(), times.end());
+      if (*slowest - *fastest < options.resolution.count())
+         return;
+
+      ComplexityFit fit = fitComplexity(sizes, times);
+      double bestError = fit.errors[static_cast<int>(fit.best)];
+      // the best fit of bound or better
+      double boundError = *std::min_element(fit.errors.begin(), fit.errors.begin() + static_cast<int>(bound) + 1);
+
+      // the largest half of the sizes, but at least two
+      size_t first = std::min(sizes.size() / 2, sizes.size() - 2);
+      std::vector<double> boundValues;
+      for (size_t n : sizes)
+         boundValues.push_back(complexityFunction(bound, n));
+      double exponent = growthExponent(sizes, times, first);
+      double boundExponent = growthExponent(sizes, boundValues, first);
+
+      std::ostringstream reason;
+      reason << std::fixed << std::setprecision(3);
+      if (bestError > options.maxFitError)
+         reason << "inconclusive, no complexity class fits the measured times (best fit is " << complexityName(fit.best)
+                << " with error " << bestError << ", at most " << options.maxFitError << " allowed)";
+      else if (exponent > boundExponent + options.exponentTolerance)
+         reason << "expected " << complexityName(bound) << ", but time grows as n^" << std::setprecision(2) << exponent
+                << " for the largest sizes (" << complexityName(bound) << " grows as n^" << boundExponent << ")";
+      else if (fit.best > bound && boundError > bestError + options.margin)
+         reason << "expected " << complexityName(bound) << ", but best fit is " << complexityName(fit.best)
+                << " (fit error " << bestError << ", " << complexityName(bound) << " has " << boundError << ")";
+      else
+         return;
+
+      std::string msg = onFail + (onFail.empty() ? "" : ": ") + reason.str() + ". Measured:";
+      for (size_t i = 0; i < sizes.size(); i++)
+         msg += "\n         n = " + std::to_string(sizes[i]) + ": " + formatNanoseconds(times[i]);
+
+      throw ComplexityAssertionFailure(msg);
+   }
+};
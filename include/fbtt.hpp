@@ -1,2 +1,3 @@
 #include "multiTest.hpp"
-#include "assert.hpp"
\ No newline at end of file
+#include "assert.hpp"
+#include "complexity.hpp"
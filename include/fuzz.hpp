@@ -0,0 +1,326 @@
+#pragma once
+
+#include "multiTest.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+
+namespace fbtt {
+   /** Error thrown by FuzzInput, when more bytes are consumed than the input contains.
+    * Inputs, that run out of bytes, are not treated as failures. */
+   struct InputExhausted : public std::runtime_error {
+      InputExhausted()
+         : std::runtime_error { "Fuzz input is exhausted." } { };
+   };
+
+   /** Error thrown by FuzzTarget::replay(), when a corpus path can't be read, or no corpus files are found. */
+   struct CorpusError : public std::runtime_error {
+      CorpusError(const std::string & s)
+         : std::runtime_error { s } { };
+   };
+
+   /** How FuzzTarget::replay() runs the corpus files.
+    * SHARED_FIXTURE: Run the files in the given order on one fixture, rebuilt with the same cadence as in fuzzing (see FuzzTarget::rebuildEvery()).
+    *    This is not the sequence of inputs the fuzzer ran: most of them are mutations, which are never saved.
+    *    A failure, that depends on state left in the fixture by earlier inputs, usually doesn't reproduce from the corpus or the saved crash file.
+    * FRESH_FIXTURE: Run every file on a freshly constructed fixture. */
+   enum class ReplayMode {
+      SHARED_FIXTURE,
+      FRESH_FIXTURE
+   };
+
+   /** Consumes the bytes of a fuzz input, front to back.
+    * @param consume<T>(): Consume a trivially copyable value of type T
+    * @param consumeInRange(): Consume an integer in the range [min, max]
+    * @param consumeBool(): Consume a boolean
+    * @param consumeBytes(): Consume n bytes
+    * @param consumeString(): Consume a string of at most maxLength characters
+    * @param remaining(): Number of bytes left
+    * @throws Every consume method throws InputExhausted, if the input has too few bytes left. */
+   class FuzzInput {
+      const uint8_t * m_data;
+      size_t m_size;
+      size_t m_position = 0;
+
+      void require(size_t n) const
+      {
+         if (remaining() < n)
+            throw InputExhausted();
+      }
+
+   public:
+      FuzzInput(const uint8_t * data, size_t size)
+         : m_data { data }, m_size { size } { };
+
+      template <typename T>
+         requires std::is_trivially_copyable_v<T>
+      T consume()
+      {
+         require(sizeof(T));
+         T value;
+         std::memcpy(&value, m_data + m_position, sizeof(T));
+         m_position += sizeof(T);
+         return value;
+      }
+
+      template <std::integral T>
+      T consumeInRange(T min, T max)
+      {
+         using Unsigned = std::make_unsigned_t<T>;
+         Unsigned range = static_cast<Unsigned>(max) - static_cast<Unsigned>(min);
+         Unsigned value = consume<Unsigned>();
+         if (range != std::numeric_limits<Unsigned>::max())
+            value %= range + 1;
+         return static_cast<T>(static_cast<Unsigned>(min) + value);
+      }
+
+      bool consumeBool()
+      {
+         return consume<uint8_t>() & 1;
+      }
+
+      std::vector<uint8_t> consumeBytes(size_t n)
+      {
+         require(n);
+         std::vector<uint8_t> bytes(m_data + m_position, m_data + m_position + n);
+         m_position += n;
+         return bytes;
+      }
+
+      std::string consumeString(size_t maxLength)
+      {
+         size_t length = std::min<size_t>(consumeInRange<size_t>(0, maxLength), remaining());
+         std::string s(reinterpret_cast<const char *>(m_data + m_position), length);
+         m_position += length;
+         return s;
+      }
+
+      size_t remaining() const { return m_size - m_position; };
+   };
+
+   /** Fuzz target built from a constructor of a MultiTest and a test body, that consumes bytes of the input.
+    * The fixture is constructed once and reused for every input, until rebuildEvery() inputs have been run.
+ * When an input fails, it is run again on a fresh fixture, and the report says, whether it fails on its own.
+    * @param runOne(): Run a single input. Used by LLVMFuzzerTestOneInput (see FBTT_FUZZ_TARGET).
+    * @param rebuildEvery(): Construct a fresh fixture after every n inputs. Defaults to 0 (never).
+    * @param replay(): Run saved corpus files as tests with the target's constructor, and output the results. */
+   template <typename ... Classes>
+   class FuzzTarget {
+   public:
+      using Body = std::function<void(FuzzInput &, Classes & ...)>;
+
+   private:
+      MultiTest<Classes...> & m_multiTest;
+      Body m_body;
+      std::string m_constructorName;
+
+      std::tuple<Classes * ...> m_fixture;
+      bool m_built = false;
+      size_t m_rebuildEvery = 0;
+      size_t m_runsSinceBuild = 0;
+
+      void build()
+      {
+         if (m_built)
+            m_multiTest.destroy(m_fixture);
+         m_built = false;
+
+         m_fixture = m_multiTest.construct(m_multiTest.constructorIndex(m_constructorName));
+         m_built = true;
+         m_runsSinceBuild = 0;
+      }
+
+      void runBody(FuzzInput & input, std::tuple<Classes * ...> & fixture)
+      {
+         std::apply([&](Classes * ... instances) {
+            m_body(input, *instances...);
+         }, fixture);
+      }
+
+      // @returns true, if the input fails on a freshly constructed fixture. The failed fixture is left untouched.
+      bool failsOnFreshFixture(const uint8_t * data, size_t size)
+      {
+         std::tuple<Classes * ...> fixture = m_multiTest.construct(m_multiTest.constructorIndex(m_constructorName));
+         FuzzInput input { data, size };
+         bool failed = false;
+         try {
+            runBody(input, fixture);
+         } catch (InputExhausted &) {
+         } catch (std::exception &) {
+            failed = true;
+         }
+         m_multiTest.destroy(fixture);
+         return failed;
+      }
+
+      [[noreturn]] void fail(const uint8_t * data, size_t size, const std::string & status, const std::string & reason)
+      {
+         size_t earlier = m_runsSinceBuild - 1;
+         std::cerr << "fbtt fuzz target: input " << status
+                   << " after " << earlier << " earlier inputs on the same fixture.\n"
+                   << "   Reason: " << reason << '\n';
+
+         // the earlier inputs are mostly mutations, which the fuzzer doesn't save
+         if (earlier > 0) {
+            if (failsOnFreshFixture(data, size))
+               std::cerr << "   The input fails on a fresh fixture too, so the saved input reproduces the failure.\n";
+            else
+               std::cerr << "   The input passes on a fresh fixture: the failure depends on state left by earlier inputs, which are not saved,\n"
+                         << "   and will not reproduce from the saved input. Fuzz with rebuildEvery(1) to find inputs, that fail on their own.\n";
+         }
+         std::abort();
+      }
+
+   public:
+      /** Construct a fuzz target.
+       * @param multiTest: MultiTest, whose constructor builds the fixture. Must outlive the fuzz target.
+       * @param body: Test body with signature void(FuzzInput &, Classes & ...). Failures are reported with fbtt assertions.
+       * @param constructorName: Name of the constructor to use. Defaults to the first constructor. */
+      FuzzTarget(MultiTest<Classes...> & multiTest, Body body, const std::string & constructorName = "")
+         : m_multiTest { multiTest },
+           m_body { body },
+           m_constructorName { constructorName } { };
+
+      FuzzTarget(const FuzzTarget &) = delete;
+      FuzzTarget & operator = (const FuzzTarget &) = delete;
+
+      ~FuzzTarget()
+      {
+         if (m_built)
+            m_multiTest.destroy(m_fixture);
+      }
+
+      /** Construct a fresh fixture after every n inputs. 0 means never. */
+      void rebuildEvery(size_t n)
+      {
+         m_rebuildEvery = n;
+      }
+
+      /** Run the body on a single input. A failing assertion or unexpected error aborts, so the fuzzer saves the input.
+       * Before aborting, the input is run on a fresh fixture, to report whether the saved input reproduces the failure.
+       * @returns 0, as expected by libFuzzer. */
+      int runOne(const uint8_t * data, size_t size)
+      {
+         if (!m_built || (m_rebuildEvery != 0 && m_runsSinceBuild >= m_rebuildEvery))
+            build();
+         m_runsSinceBuild++;
+
+         FuzzInput input { data, size };
+         try {
+            runBody(input, m_fixture);
+         } catch (InputExhausted &) {
+            // the input was too short: not a failure
+         } catch (AssertionFailure & e) {
+            fail(data, size, "failed in assertion", e.what());
+         } catch (std::exception & e) {
+            fail(data, size, "threw unexpected error", e.what());
+         }
+
+         return 0;
+      }
+
+      /** Run saved corpus files as tests, with the constructor of the target, and output the results.
+       * Directories are replaced by the files in them, sorted by name. Files are run in the given order.
+       * @param paths: Corpus files, or directories of corpus files
+       * @param mode: Run the files on one shared fixture, or on a fresh fixture each (see ReplayMode)
+       * @returns Error code of the test results (see getErrorCode())
+       * @throws CorpusError if a path doesn't exist, a file can't be read, or no corpus files are found. */
+      int replay(const std::vector<std::string> & paths, ReplayMode mode = ReplayMode::SHARED_FIXTURE, std::ostream & os = std::cout)
+      {
+         std::vector<std::filesystem::path> files;
+         for (const std::string & path : paths) {
+            if (std::filesystem::is_directory(path)) {
+               std::vector<std::filesystem::path> directory;
+               for (const auto & entry : std::filesystem::directory_iterator(path))
+                  if (entry.is_regular_file())
+                     directory.push_back(entry.path());
+               std::sort(directory.begin(), directory.end());
+               files.insert(files.end(), directory.begin(), directory.end());
+            } else if (std::filesystem::exists(path)) {
+               files.push_back(path);
+            } else {
+               throw CorpusError("Corpus path doesn't exist: " + path);
+            }
+         }
+
+         if (files.empty())
+            throw CorpusError("No corpus files found. Give corpus files or directories as arguments.");
+
+         std::vector<TestResult> results;
+         if (m_built)
+            m_multiTest.destroy(m_fixture);
+         m_built = false;
+
+         for (const auto & file : files) {
+            std::ifstream is { file, std::ios::binary };
+            if (!is)
+               throw CorpusError("Can't read corpus file: " + file.string());
+            std::vector<uint8_t> bytes { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+
+            Test<NoError, Classes & ...> test { "corpus file " + file.string(), [&](Classes & ... instances) {
+               FuzzInput input { bytes.data(), bytes.size() };
+               try {
+                  m_body(input, instances...);
+               } catch (InputExhausted &) { }
+            }};
+
+            if (mode == ReplayMode::FRESH_FIXTURE || !m_built || (m_rebuildEvery != 0 && m_runsSinceBuild >= m_rebuildEvery))
+               build();
+            m_runsSinceBuild++;
+
+            std::apply([&](Classes * ... instances) {
+               test.run(*instances...);
+            }, m_fixture);
+            results.push_back(test.result());
+
+            // the fuzzer stops at a failure, so later inputs start on a fresh fixture
+            if (results.back().testFailed()) {
+               m_multiTest.destroy(m_fixture);
+               m_built = false;
+            }
+         }
+
+         os << TerminalColor::WHITE << TerminalStyle::BOLD
+            << "Replay of " << files.size() << " corpus files ("
+            << (mode == ReplayMode::SHARED_FIXTURE ? "shared fixture" : "fresh fixture for every file") << "):\n"
+            << TerminalStyle::NONE;
+         for (const TestResult & res : results)
+            os << "   " << res;
+
+         return getErrorCode(results);
+      }
+   };
+};
+
+#if defined(FBTT_FUZZING) || defined(FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION)
+   // libFuzzer provides main()
+   #define FBTT_FUZZ_REPLAY_MAIN(makeTarget)
+#else
+   #define FBTT_FUZZ_REPLAY_MAIN(makeTarget) \
+      int main(int argc, char ** argv) \
+      { \
+         try { \
+            return makeTarget().replay(std::vector<std::string>(argv + 1, argv + argc)); \
+         } catch (std::exception & e) { \
+            std::cerr << e.what() << '\n'; \
+            return 1; \
+         } \
+      }
+#endif
+
+/** Define the entry points for a fuzz target. makeTarget must be a function, returning a reference to a fbtt::FuzzTarget.
+ * Defines LLVMFuzzerTestOneInput() for libFuzzer. Unless FBTT_FUZZING is defined, also defines a main(),
+ * which replays the corpus files and directories given as arguments in order on a shared fixture. */
+#define FBTT_FUZZ_TARGET(makeTarget) \
+   extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) \
+   { \
+      return makeTarget().runOne(data, size); \
+   } \
+   FBTT_FUZZ_REPLAY_MAIN(makeTarget)
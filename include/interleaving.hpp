@@ -0,0 +1,807 @@
+#pragma once
+
+#include "test.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace fbtt {
+   /** Thrown at yield points, when the schedule is aborted after a failure in another thread. Caught by the Scheduler. */
+   struct ScheduleAborted : public std::exception {
+      virtual const char * what() const noexcept
+      {
+         return "Schedule aborted.";
+      };
+   };
+
+   /** Strategy for choosing the next thread to run at every yield point.
+    * RANDOM: Choose uniformly between the runnable threads.
+    * PCT: Probabilistic concurrency testing. Run the runnable thread with the highest random priority, and lower the priority of the running thread at pctDepth - 1 random steps.
+    * EXHAUSTIVE: Depth first search over every interleaving, until options.schedules is reached.
+    *    Interleavings, where a thread runs more than options.maxStreak times in a row while other threads could run, are skipped. */
+   enum class InterleavingStrategy {
+      RANDOM,
+      PCT,
+      EXHAUSTIVE
+   };
+
+   /** Options for an interleaving test (see MultiTest::addInterleavingTest()).
+    * @param strategy: How threads are chosen at yield points
+    * @param schedules: Maximum number of schedules to explore
+    * @param seed: Seed of the first schedule. Schedule i is run with seed + i.
+    * @param pctDepth: Number of priority changes + 1 for the PCT strategy. Finds bugs, that need up to pctDepth ordered events.
+    * @param pctSteps: Expected number of steps in a schedule. Priority changes are chosen between step 1 and pctSteps. Defaults to 0: the most steps seen in an earlier schedule.
+    * @param maxStreak: Limit for a thread, which is chosen at this many yield points in a row, while other threads could run.
+    *    PCT lowers the priority of the thread, and EXHAUSTIVE runs another thread. Keeps a spin-wait from starving the thread it waits for. 0 means no limit.
+    * @param maxSteps: A schedule with more steps than this fails (livelock).
+    * @param replay: Schedule reported by a failing test. If given, only this schedule is run. */
+   struct InterleavingOptions {
+      InterleavingStrategy strategy = InterleavingStrategy::PCT;
+      size_t schedules = 1000;
+      uint64_t seed = 1;
+      size_t pctDepth = 3;
+      size_t pctSteps = 0;
+      size_t maxStreak = 64;
+      size_t maxSteps = 100000;
+      std::string replay = "";
+   };
+
+   // abstract base class for the strategies of InterleavingStrategy
+   class ScheduleStrategy {
+   public:
+      ScheduleStrategy() { };
+      virtual void begin(size_t threads, uint64_t seed) = 0;
+      virtual size_t choose(const std::vector<size_t> & runnable, size_t current, size_t step) = 0;
+      virtual ~ScheduleStrategy() { };
+   };
+
+   // random number in [0, n). Doesn't use std distributions, so a seed gives the same schedule with every standard library.
+   size_t randomBelow(std::mt19937_64 & random, size_t n)
+   {
+      return static_cast<size_t>(random() % n);
+   }
+
+   class RandomStrategy : public ScheduleStrategy {
+      std::mt19937_64 m_random;
+
+   public:
+      virtual void begin(size_t, uint64_t seed)
+      {
+         m_random.seed(seed);
+      }
+
+      virtual size_t choose(const std::vector<size_t> & runnable, size_t, size_t)
+      {
+         return runnable[randomBelow(m_random, runnable.size())];
+      }
+   };
+
+   class PctStrategy : public ScheduleStrategy {
+      const size_t m_depth;
+      const bool m_adaptive;
+      const size_t m_maxStreak;
+      size_t m_steps;
+      size_t m_maxStep = 1;
+      std::vector<long long> m_priorities;
+      std::vector<size_t> m_changePoints;
+
+      long long m_lowest = 0;
+      size_t m_last = static_cast<size_t>(-1);
+      size_t m_streak = 0;
+
+      size_t highestPriority(const std::vector<size_t> & runnable) const
+      {
+         return *std::max_element(runnable.begin(), runnable.end(), [&](size_t a, size_t b) {
+            return m_priorities[a] < m_priorities[b];
+         });
+      }
+
+   public:
+      /** @param steps: Expected number of steps in a schedule. 0 means the most steps seen in an earlier schedule.
+       * @param maxStreak: Lower the priority of a thread, which is chosen this many times in a row. 0 means never. */
+      PctStrategy(size_t depth, size_t steps, size_t maxStreak)
+         : m_depth { std::max<size_t>(depth, 1) },
+           m_adaptive { steps == 0 },
+           m_maxStreak { maxStreak },
+           m_steps { std::max<size_t>(steps, 1) } { };
+
+      virtual void begin(size_t threads, uint64_t seed)
+      {
+         if (m_adaptive)
+            m_steps = m_maxStep;
+
+         std::mt19937_64 random { seed };
+
+         // initial priorities are pctDepth, ..., pctDepth + threads - 1, shuffled
+         m_priorities.resize(threads);
+         for (size_t i = 0; i < threads; i++)
+            m_priorities[i] = m_depth + i;
+         for (size_t i = threads; i > 1; i--)
+            std::swap(m_priorities[i - 1], m_priorities[randomBelow(random, i)]);
+
+         m_changePoints.clear();
+         for (size_t i = 0; i + 1 < m_depth; i++)
+            m_changePoints.push_back(1 + randomBelow(random, m_steps));
+
+         m_lowest = 0;
+         m_last = static_cast<size_t>(-1);
+         m_streak = 0;
+      }
+
+      virtual size_t choose(const std::vector<size_t> & runnable, size_t current, size_t step)
+      {
+         m_maxStep = std::max(m_maxStep, step);
+
+         // at the i'th change point, the running thread gets priority i, lower than every initial priority
+         for (size_t i = 0; i < m_changePoints.size(); i++)
+            if (m_changePoints[i] == step && current < m_priorities.size())
+               m_priorities[current] = i;
+
+         size_t next = highestPriority(runnable);
+         m_streak = next == m_last ? m_streak + 1 : 1;
+         m_last = next;
+
+         // a thread, that keeps running while others wait, is probably spinning: give it the lowest priority
+         if (m_maxStreak != 0 && m_streak > m_maxStreak) {
+            m_priorities[next] = --m_lowest;
+            next = highestPriority(runnable);
+            m_last = next;
+            m_streak = 1;
+         }
+         return next;
+      }
+
+      /** @returns Expected number of steps used by the current schedule */
+      size_t steps() const { return m_steps; };
+   };
+
+   class ExhaustiveStrategy : public ScheduleStrategy {
+      struct Decision {
+         std::vector<size_t> runnable;
+         size_t chosen;
+      };
+
+      const size_t m_maxStreak;
+      std::vector<Decision> m_path;
+      size_t m_position = 0;
+
+      size_t m_last = static_cast<size_t>(-1);
+      size_t m_streak = 0;
+
+   public:
+      /** @param maxStreak: Don't choose a thread more than this many times in a row. 0 means no limit. */
+      ExhaustiveStrategy(size_t maxStreak)
+         : m_maxStreak { maxStreak } { };
+
+      virtual void begin(size_t, uint64_t)
+      {
+         m_position = 0;
+         m_last = static_cast<size_t>(-1);
+         m_streak = 0;
+      }
+
+      virtual size_t choose(const std::vector<size_t> & runnable, size_t, size_t)
+      {
+         // follow the path of the previous schedule, and take the first thread at new decisions
+         if (m_position == m_path.size()) {
+            std::vector<size_t> choices = runnable;
+            // a thread, that has run maxStreak times in a row, is probably spinning: skip the branches, where it runs again
+            if (m_maxStreak != 0 && m_streak >= m_maxStreak)
+               choices.erase(std::remove(choices.begin(), choices.end(), m_last), choices.end());
+            m_path.push_back({ choices, 0 });
+         }
+
+         const Decision & decision = m_path[m_position++];
+         size_t next = decision.runnable[decision.chosen];
+
+         // the test is not deterministic, if the thread is not runnable at the same point as in the previous schedule
+         if (std::find(runnable.begin(), runnable.end(), next) == runnable.end())
+            next = runnable.front();
+
+         m_streak = next == m_last ? m_streak + 1 : 1;
+         m_last = next;
+         return next;
+      }
+
+      /** Go to the next schedule of the depth first search.
+       * @returns false, if every schedule has been explored. */
+      bool advance()
+      {
+         while (!m_path.empty() && m_path.back().chosen + 1 >= m_path.back().runnable.size())
+            m_path.pop_back();
+
+         if (m_path.empty())
+            return false;
+
+         m_path.back().chosen++;
+         return true;
+      }
+   };
+
+   class ReplayStrategy : public ScheduleStrategy {
+      const std::vector<size_t> m_schedule;
+      size_t m_position = 0;
+
+   public:
+      ReplayStrategy(const std::vector<size_t> & schedule)
+         : m_schedule { schedule } { };
+
+      virtual void begin(size_t, uint64_t)
+      {
+         m_position = 0;
+      }
+
+      virtual size_t choose(const std::vector<size_t> & runnable, size_t, size_t)
+      {
+         if (m_position < m_schedule.size()) {
+            size_t next = m_schedule[m_position++];
+            if (std::find(runnable.begin(), runnable.end(), next) != runnable.end())
+               return next;
+         }
+         return runnable.front();
+      }
+   };
+
+   /** @returns Schedule as a string of thread ids, where repeated ids are written as id*count, e.g. "0*3,1,0". */
+   std::string encodeSchedule(const std::vector<size_t> & schedule)
+   {
+      std::ostringstream os;
+      for (size_t i = 0; i < schedule.size(); ) {
+         size_t count = 1;
+         while (i + count < schedule.size() && schedule[i + count] == schedule[i])
+            count++;
+
+         os << (i == 0 ? "" : ",") << schedule[i];
+         if (count > 1)
+            os << '*' << count;
+         i += count;
+      }
+      return os.str();
+   }
+
+   /** @returns Schedule from a string made by encodeSchedule().
+    * @throws std::invalid_argument if the string is not a schedule. */
+   std::vector<size_t> decodeSchedule(const std::string & s)
+   {
+      std::vector<size_t> schedule;
+      std::istringstream is { s };
+      std::string token;
+      while (std::getline(is, token, ',')) {
+         size_t star = token.find('*');
+         try {
+            size_t id = std::stoul(token.substr(0, star));
+            size_t count = star == std::string::npos ? 1 : std::stoul(token.substr(star + 1));
+            schedule.insert(schedule.end(), count, id);
+         } catch (std::logic_error &) {
+            throw std::invalid_argument("malformed schedule \"" + s + "\" at \"" + token + "\"");
+         }
+      }
+      return schedule;
+   }
+
+   /** Cooperative scheduler. Runs every thread body in its own thread, but only one at a time.
+    * At every yield point (fbtt::yield(), fbtt::Atomic, fbtt::Mutex) the strategy chooses the thread to run next.
+    * The threads are kept between calls of run(), so many schedules can be run quickly.
+    * @param run(): Run thread bodies to completion
+    * @param status(): Status of the last schedule (PASSED, if no thread failed)
+    * @param failure(): Reason for failure
+    * @param schedule(): The choices made, one for every yield point with more than one runnable thread */
+   class Scheduler {
+      static constexpr size_t NONE = static_cast<size_t>(-1);
+
+      struct ThreadState {
+         bool finished = true;
+         const void * blockedOn = nullptr;
+      };
+
+      static inline thread_local Scheduler * t_current = nullptr;
+      static inline thread_local size_t t_threadId = NONE;
+
+      ScheduleStrategy & m_strategy;
+      const size_t m_maxSteps;
+
+      std::mutex m_mutex;
+      std::vector<std::condition_variable> m_wake; // one for every thread
+      std::condition_variable m_done;
+      std::vector<std::thread> m_workers;
+      const std::vector<std::function<void()>> * m_bodies = nullptr;
+      bool m_shutdown = false;
+
+      std::vector<ThreadState> m_threads;
+      size_t m_running = NONE;
+      size_t m_steps = 0;
+      bool m_aborting = false;
+
+      std::vector<size_t> m_schedule;
+      TestResult::Status m_statusCode = TestResult::Status::PASSED;
+      std::string m_failureString = "";
+
+      bool allFinished() const
+      {
+         return std::all_of(m_threads.begin(), m_threads.end(), [](const ThreadState & t) { return t.finished; });
+      }
+
+      std::vector<size_t> runnableThreads() const
+      {
+         std::vector<size_t> runnable;
+         for (size_t i = 0; i < m_threads.size(); i++)
+            if (!m_threads[i].finished && m_threads[i].blockedOn == nullptr)
+               runnable.push_back(i);
+         return runnable;
+      }
+
+      // first failure aborts the schedule. Must be called with m_mutex held.
+      void fail(TestResult::Status status, const std::string & reason)
+      {
+         if (!m_aborting) {
+            m_statusCode = status;
+            m_failureString = reason;
+         }
+         m_aborting = true;
+      }
+
+      // hand over to the next thread, and wait until self is chosen again. Must be called with m_mutex held.
+      void scheduleNext(std::unique_lock<std::mutex> & lock, size_t self)
+      {
+         std::vector<size_t> runnable = runnableThreads();
+         if (runnable.empty()) {
+            if (allFinished()) {
+               m_running = NONE;
+               m_done.notify_one();
+               return;
+            }
+
+            fail(TestResult::Status::ASSERTION_FAILURE, "deadlock: every thread is blocked");
+            for (ThreadState & t : m_threads)
+               t.blockedOn = nullptr;
+            runnable = runnableThreads();
+         }
+
+         size_t next = runnable.front();
+         if (runnable.size() > 1 && !m_aborting) {
+            next = m_strategy.choose(runnable, self, m_steps);
+            m_schedule.push_back(next);
+         }
+
+         m_running = next;
+         if (next != self)
+            m_wake[next].notify_one();
+         if (self != NONE && !m_threads[self].finished)
+            m_wake[self].wait(lock, [&]() { return m_running == self; });
+      }
+
+      void throwIfAborting()
+      {
+         // don't throw, while the thread is already unwinding
+         if (m_aborting && std::uncaught_exceptions() == 0)
+            throw ScheduleAborted();
+      }
+
+      void runBody(size_t id)
+      {
+         try {
+            (*m_bodies)[id]();
+         } catch (ScheduleAborted &) {
+            // another thread failed
+         } catch (AssertionFailure & e) {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            fail(TestResult::Status::ASSERTION_FAILURE, "thread " + std::to_string(id) + ": " + std::string(e.what()));
+         } catch (std::exception & e) {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            fail(TestResult::Status::UNEXPECTED_ERROR, "thread " + std::to_string(id) + " threw error with message: " + std::string(e.what()));
+         } catch (...) {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            fail(TestResult::Status::UNKNOWN_FAILURE, "thread " + std::to_string(id) + " threw unknown error");
+         }
+      }
+
+      void work(size_t id)
+      {
+         t_current = this;
+         t_threadId = id;
+
+         std::unique_lock<std::mutex> lock { m_mutex };
+         while (true) {
+            m_wake[id].wait(lock, [&]() { return m_shutdown || m_running == id; });
+            if (m_shutdown)
+               break;
+
+            lock.unlock();
+            runBody(id);
+            lock.lock();
+
+            m_threads[id].finished = true;
+            scheduleNext(lock, id);
+         }
+         t_current = nullptr;
+      }
+
+   public:
+      /** Construct a scheduler for the given number of threads. */
+      Scheduler(size_t threads, ScheduleStrategy & strategy, size_t maxSteps)
+         : m_strategy { strategy }, m_maxSteps { maxSteps }, m_wake(threads), m_threads(threads) { };
+
+      Scheduler(const Scheduler &) = delete;
+      Scheduler & operator = (const Scheduler &) = delete;
+
+      ~Scheduler()
+      {
+         {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_shutdown = true;
+            for (std::condition_variable & wake : m_wake)
+               wake.notify_one();
+         }
+         for (std::thread & worker : m_workers)
+            worker.join();
+      }
+
+      /** @returns The scheduler of the calling thread, or nullptr, if the thread is not run by a scheduler. */
+      static Scheduler * current() { return t_current; };
+
+      /** Yield point: let the strategy choose the thread to run next.
+       * @param mayThrow: Throw ScheduleAborted, if the schedule is aborted.
+       * @throws ScheduleAborted, if mayThrow, and the schedule is aborted. */
+      void yieldPoint(bool mayThrow = true)
+      {
+         std::unique_lock<std::mutex> lock { m_mutex };
+         if (!m_aborting) {
+            if (++m_steps > m_maxSteps)
+               fail(TestResult::Status::ASSERTION_FAILURE, "schedule exceeded " + std::to_string(m_maxSteps) + " steps (livelock?)");
+            else
+               scheduleNext(lock, t_threadId);
+         }
+
+         if (mayThrow)
+            throwIfAborting();
+      }
+
+      /** Block the calling thread on resource, until unblock() is called with resource.
+       * @returns false, if the schedule is aborted, and the thread can't be unwound. The resource should be treated as acquired. */
+      bool block(const void * resource)
+      {
+         std::unique_lock<std::mutex> lock { m_mutex };
+         if (!m_aborting) {
+            m_threads[t_threadId].blockedOn = resource;
+            scheduleNext(lock, t_threadId);
+         }
+
+         if (m_aborting) {
+            m_threads[t_threadId].blockedOn = nullptr;
+            throwIfAborting();
+            return false;
+         }
+         return true;
+      }
+
+      /** Make every thread blocked on resource runnable. */
+      void unblock(const void * resource)
+      {
+         std::unique_lock<std::mutex> lock { m_mutex };
+         for (ThreadState & t : m_threads)
+            if (t.blockedOn == resource)
+               t.blockedOn = nullptr;
+      }
+
+      /** Run one schedule: every body in its own thread, one thread at a time. Waits until every thread has finished.
+       * @param bodies: One function for every thread of the scheduler */
+      void run(const std::vector<std::function<void()>> & bodies)
+      {
+         std::unique_lock<std::mutex> lock { m_mutex };
+         m_bodies = &bodies;
+         m_threads.assign(m_wake.size(), { false, nullptr });
+         m_steps = 0;
+         m_aborting = false;
+         m_schedule.clear();
+         m_statusCode = TestResult::Status::PASSED;
+         m_failureString = "";
+
+         while (m_workers.size() < m_wake.size()) {
+            size_t id = m_workers.size();
+            m_workers.emplace_back([this, id]() { work(id); });
+         }
+
+         if (m_threads.empty())
+            return;
+
+         scheduleNext(lock, NONE);
+         m_done.wait(lock, [&]() { return allFinished(); });
+      }
+
+      TestResult::Status status() const { return m_statusCode; };
+      const std::string & failure() const { return m_failureString; };
+      const std::vector<size_t> & schedule() const { return m_schedule; };
+      size_t steps() const { return m_steps; };
+   };
+
+   /** Yield point for interleaving tests. Lets the scheduler switch to another thread. Does nothing, if the calling thread is not run by a scheduler.
+    * @throws ScheduleAborted, if another thread of the schedule has failed. */
+   void yield()
+   {
+      if (Scheduler * scheduler = Scheduler::current())
+         scheduler->yieldPoint();
+   }
+
+   /** std::atomic<T> with a yield point before every operation. Behaves like std::atomic<T>, when not run by a scheduler.
+    * Operations throw ScheduleAborted, if another thread of the schedule has failed. */
+   template <typename T>
+   class Atomic {
+      std::atomic<T> m_value;
+
+   public:
+      Atomic() : m_value { } { };
+      Atomic(T value) : m_value { value } { };
+
+      Atomic(const Atomic &) = delete;
+      Atomic & operator = (const Atomic &) = delete;
+
+      T load(std::memory_order order = std::memory_order_seq_cst)
+      {
+         yield();
+         return m_value.load(order);
+      }
+
+      void store(T value, std::memory_order order = std::memory_order_seq_cst)
+      {
+         yield();
+         m_value.store(value, order);
+      }
+
+      T exchange(T value, std::memory_order order = std::memory_order_seq_cst)
+      {
+         yield();
+         return m_value.exchange(value, order);
+      }
+
+      bool compare_exchange_strong(T & expected, T desired, std::memory_order order = std::memory_order_seq_cst)
+      {
+         yield();
+         return m_value.compare_exchange_strong(expected, desired, order);
+      }
+
+      bool compare_exchange_weak(T & expected, T desired, std::memory_order order = std::memory_order_seq_cst)
+      {
+         yield();
+         return m_value.compare_exchange_weak(expected, desired, order);
+      }
+
+      T fetch_add(T arg, std::memory_order order = std::memory_order_seq_cst)
+         requires requires (std::atomic<T> & a, T v) { a.fetch_add(v); }
+      {
+         yield();
+         return m_value.fetch_add(arg, order);
+      }
+
+      T fetch_sub(T arg, std::memory_order order = std::memory_order_seq_cst)
+         requires requires (std::atomic<T> & a, T v) { a.fetch_sub(v); }
+      {
+         yield();
+         return m_value.fetch_sub(arg, order);
+      }
+
+      operator T () { return load(); };
+      T operator = (T value) { store(value); return value; };
+      T operator ++ () { return fetch_add(1) + 1; };
+      T operator ++ (int) { return fetch_add(1); };
+      T operator -- () { return fetch_sub(1) - 1; };
+      T operator -- (int) { return fetch_sub(1); };
+      T operator += (T arg) { return fetch_add(arg) + arg; };
+      T operator -= (T arg) { return fetch_sub(arg) - arg; };
+   };
+
+   /** Mutex with yield points, which blocks the thread in the scheduler, when the mutex is taken. Behaves like std::mutex, when not run by a scheduler.
+    * Can be used with std::lock_guard and std::unique_lock. */
+   class Mutex {
+      std::mutex m_native;
+      bool m_locked = false; // only used, when run by a scheduler
+
+   public:
+      Mutex() { };
+      Mutex(const Mutex &) = delete;
+      Mutex & operator = (const Mutex &) = delete;
+
+      void lock()
+      {
+         Scheduler * scheduler = Scheduler::current();
+         if (!scheduler) {
+            m_native.lock();
+            return;
+         }
+
+         scheduler->yieldPoint();
+         while (m_locked)
+            if (!scheduler->block(this))
+               break;
+         m_locked = true;
+      }
+
+      bool try_lock()
+      {
+         Scheduler * scheduler = Scheduler::current();
+         if (!scheduler)
+            return m_native.try_lock();
+
+         scheduler->yieldPoint();
+         if (m_locked)
+            return false;
+         m_locked = true;
+         return true;
+      }
+
+      void unlock()
+      {
+         Scheduler * scheduler = Scheduler::current();
+         if (!scheduler) {
+            m_native.unlock();
+            return;
+         }
+
+         m_locked = false;
+         scheduler->unblock(this);
+         // unlock is called from destructors (std::lock_guard), so it must not throw
+         scheduler->yieldPoint(false);
+      }
+   };
+
+   /** Interleaving test. Runs thread bodies on the same instances under a Scheduler, for many different schedules.
+    * Every schedule is run on freshly constructed instances. If a schedule fails, the seed and schedule to replay it are reported.
+    * @param run(): Explore schedules
+    * @param result(): Return result of test : TestResult
+    * @param name(): Returns name of test */
+   template <typename ... Classes>
+   class InterleavingTest : public AbstractTest<Classes & ...> {
+   public:
+      using Instances = std::tuple<Classes * ...>;
+
+   private:
+      const std::string m_name;
+      const std::vector<std::function<void(Classes & ...)>> m_threads;
+      const std::function<void(Classes & ...)> m_check;
+      const InterleavingOptions m_options;
+      const std::function<Instances()> m_construct;
+      const std::function<void(Instances &)> m_destroy;
+
+      std::string m_failureString = "";
+      std::string m_details = "";
+      TestResult::Status m_statusCode = TestResult::Status::NOT_RUN;
+
+      std::unique_ptr<ScheduleStrategy> makeStrategy() const
+      {
+         if (!m_options.replay.empty())
+            return std::make_unique<ReplayStrategy>(decodeSchedule(m_options.replay));
+
+         switch (m_options.strategy) {
+            case InterleavingStrategy::RANDOM:
+               return std::make_unique<RandomStrategy>();
+            case InterleavingStrategy::EXHAUSTIVE:
+               return std::make_unique<ExhaustiveStrategy>(m_options.maxStreak);
+            default:
+               return std::make_unique<PctStrategy>(m_options.pctDepth, m_options.pctSteps, m_options.maxStreak);
+         };
+      }
+
+      // run a single schedule on instances. Returns status and reason for failure.
+      std::pair<TestResult::Status, std::string> runSchedule(Scheduler & scheduler, ScheduleStrategy & strategy, uint64_t seed, Instances & instances)
+      {
+         strategy.begin(m_threads.size(), seed);
+
+         std::vector<std::function<void()>> bodies;
+         for (const auto & thread : m_threads) {
+            bodies.push_back([&]() {
+               std::apply([&](Classes * ... c) { thread(*c...); }, instances);
+            });
+         }
+         scheduler.run(bodies);
+
+         if (scheduler.status() != TestResult::Status::PASSED || !m_check)
+            return { scheduler.status(), scheduler.failure() };
+
+         try {
+            std::apply([&](Classes * ... c) { m_check(*c...); }, instances);
+         } catch (AssertionFailure & e) {
+            return { TestResult::Status::ASSERTION_FAILURE, "check after threads: " + std::string(e.what()) };
+         } catch (std::exception & e) {
+            return { TestResult::Status::UNEXPECTED_ERROR, "check after threads threw error with message: " + std::string(e.what()) };
+         }
+         return { TestResult::Status::PASSED, "" };
+      }
+
+   public:
+      /** Construct a new interleaving test.
+       * @param name: Name of test
+       * @param threads: Function for every thread. Shared state must be accessed through yield points (fbtt::yield(), fbtt::Atomic, fbtt::Mutex).
+       * @param check: Function run after every thread has finished, e.g. to assert invariants. May be empty.
+       * @param options: Strategy and number of schedules
+       * @param construct: Constructs fresh instances for a schedule
+       * @param destroy: Deletes instances made by construct */
+      InterleavingTest(const std::string & name,
+         const std::vector<std::function<void(Classes & ...)>> & threads,
+         std::function<void(Classes & ...)> check,
+         const InterleavingOptions & options,
+         std::function<Instances()> construct,
+         std::function<void(Instances &)> destroy)
+         : m_name { name },
+           m_threads { threads },
+           m_check { check },
+           m_options { options },
+           m_construct { construct },
+           m_destroy { destroy } { };
+
+      /** Explore schedules. The first schedule is run on the given instances, the rest on freshly constructed instances. */
+      virtual void run(Classes & ... instances) noexcept
+      {
+         m_failureString = "";
+         m_details = "";
+         size_t schedules = m_options.replay.empty() ? m_options.schedules : 1;
+
+         try {
+            // a malformed replay string throws here
+            std::unique_ptr<ScheduleStrategy> strategy = makeStrategy();
+            Scheduler scheduler { m_threads.size(), *strategy, m_options.maxSteps };
+            size_t explored = 0;
+            bool complete = false;
+            while (explored < schedules) {
+               uint64_t seed = m_options.seed + explored;
+               Instances fixture = explored == 0 ? Instances { &instances... } : m_construct();
+
+               auto [status, reason] = runSchedule(scheduler, *strategy, seed, fixture);
+               if (explored > 0)
+                  m_destroy(fixture);
+               explored++;
+
+               if (status != TestResult::Status::PASSED) {
+                  m_statusCode = status;
+                  m_failureString = reason + " (in schedule " + std::to_string(explored) + ")";
+
+                  std::ostringstream os;
+                  os << "      replay with InterleavingOptions { ";
+                  if (m_options.replay.empty() && m_options.strategy != InterleavingStrategy::EXHAUSTIVE) {
+                     // in declaration order, so it can be used as designated initializers
+                     os << ".schedules = 1, .seed = " << seed;
+                     if (PctStrategy * pct = dynamic_cast<PctStrategy *>(strategy.get()))
+                        os << ", .pctSteps = " << pct->steps();
+                     os << " } or { ";
+                  }
+                  os << ".replay = \"" << encodeSchedule(scheduler.schedule()) << "\" }";
+                  m_details = os.str();
+                  return;
+               }
+
+               ExhaustiveStrategy * exhaustive = dynamic_cast<ExhaustiveStrategy *>(strategy.get());
+               if (exhaustive && !exhaustive->advance()) {
+                  complete = true;
+                  break;
+               }
+            }
+
+            m_statusCode = TestResult::Status::PASSED;
+            m_details = "      explored " + std::string(complete ? "all " : "") + std::to_string(explored) + " schedules";
+         } catch (std::exception & e) {
+            m_statusCode = TestResult::Status::UNEXPECTED_ERROR;
+            m_failureString = "interleaving test threw error with message: " + std::string(e.what());
+         }
+      }
+
+      /** @returns Name of test */
+      virtual const std::string & name() const { return m_name; };
+
+      /** @returns Result of test. The details contain the number of explored schedules, or how to replay a failing schedule. */
+      virtual TestResult result() const
+      {
+         return { name(), m_statusCode, m_failureString, m_details };
+      }
+
+      virtual ~InterleavingTest() { };
+   };
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "test.hpp"
+#include "scaling.hpp"
+#include "interleaving.hpp"
 
 #include <tuple>
 #include <functional>
@@ -13,6 +15,8 @@ namespace fbtt {
    struct NoConstructor : public std::runtime_error  {
       NoConstructor() 
          : std::runtime_error { "No constructor defined! Define a constructor with MultiTest::addConstructor(). "} { };
+      NoConstructor(const std::string & s)
+         : std::runtime_error { "No constructor with name: " + s } { };
    };
 
    /** Error thrown by MultiTest, when an instance in the MultiClass is undefined, after a constructor has been called. */
@@ -25,6 +29,8 @@ namespace fbtt {
 
    /** MultiTest class. Class for testing 0 or more classes. Constructs class with either default or user-defined (by addConstructor) constructor, and runs every test with the constructed instance[s].
     * @param add_test(): Add test with a name and storable function, that takes references to instances of "Classes..."
+    * @param add_scaling_benchmark(): Add benchmark, that runs a function on the instance[s] with 1, 2, 4, ... threads
+    * @param add_interleaving_test(): Add test, that runs functions in concurrent threads under many different schedules
     * @param add_constructor(): Add constructor to be run before every test. Default constructor is automatically added, if every type in "Classes..." is default constructible.
     * @param run(): Run tests.
    */
@@ -39,6 +45,7 @@ namespace fbtt {
       
       std::string m_name;
       bool finished = false;
+      size_t m_currentConstructor = 0; // constructor used by run(), for tests which construct more instances
 
       template <typename ... Cls>
       friend void addDefaultConstructorToMultitest(MultiTest<Cls...>& mt);
@@ -98,8 +105,36 @@ namespace fbtt {
          m_tests.push_back(t);
       }
 
-      /** Run and evaluate all tests. */
-      void run()
+      /** Add scaling benchmark to multitest. The function is called from 1, 2, 4, ... up to options.maxThreads threads on the same instances,
+       * and throughput, speedup and parallel efficiency are reported for every thread count.
+       * @param func: Pointer to storable function with signature void(Classes &...). Must be thread safe.
+       * @param options: Number of threads and operations, and an optional minimum parallel efficiency (see ScalingOptions) */
+      void addScalingBenchmark(const std::string & benchmarkName, std::function<void(Classes &...)> func, const ScalingOptions & options = { })
+      {
+         AbstractTest<Classes &...> * t = new ScalingBenchmark<Classes & ...>(benchmarkName, func, options);
+         m_tests.push_back(t);
+      }
+
+      /** Add interleaving test to multitest. Every function in threads is run in its own thread, one thread at a time,
+       * switching thread at every yield point (fbtt::yield(), fbtt::Atomic, fbtt::Mutex). Schedules are explored by options.strategy,
+       * each on instances made by a fresh call to the constructor. A failing schedule is reported with a seed and schedule to replay it.
+       * @param threads: Pointers to storable functions with signature void(Classes &...), one for every thread
+       * @param check: Storable function with signature void(Classes &...), called after every schedule, e.g. to assert invariants. May be empty.
+       * @param options: Strategy and number of schedules (see InterleavingOptions) */
+      void addInterleavingTest(const std::string & testName,
+         const std::vector<std::function<void(Classes &...)>> & threads,
+         std::function<void(Classes &...)> check = { },
+         const InterleavingOptions & options = { })
+      {
+         AbstractTest<Classes &...> * t = new InterleavingTest<Classes...>(testName, threads, check, options,
+            [this]() { return construct(m_currentConstructor); },
+            [this](std::tuple<Classes * ...> & instances) { destroy(instances); });
+         m_tests.push_back(t);
+      }
+
+      /** Add the default constructor, if no constructor has been added by user.
+       * @throws NoConstructor if no constructor is added, and not every type in "Classes..." is default constructible. */
+      void ensureConstructor()
       {
          if (m_constructors.size() == 0) {
             if (VariadicDefaultInitializable<Classes...>)
@@ -107,17 +142,61 @@ namespace fbtt {
             else
                throw NoConstructor();
          }
+      }
 
-         for (size_t i = 0; i < m_constructors.size(); i++) {
-            for (size_t j = 0; j < m_tests.size(); j++) {
-               std::apply(set_instances_to_null, m_instanceTuple);
+      /** @returns Index of the constructor with the given name. An empty name gives the first constructor.
+       * @throws NoConstructor if there is no constructor with the given name. */
+      size_t constructorIndex(const std::string & name = "")
+      {
+         ensureConstructor();
+         if (name.empty())
+            return 0;
 
-               std::apply(m_constructors[i], m_instanceTuple);
+         for (size_t i = 0; i < m_constructorNames.size(); i++)
+            if (m_constructorNames[i] == name)
+               return i;
 
-               std::apply([&](Classes * ... instances) {
-                  if (instances_are_nullptr(instances...))
-                     throw UndefinedInstance(m_constructorNames[i]);
-               }, m_instanceTuple);
+         throw NoConstructor(name);
+      }
+
+      /** Construct instances with a constructor of the test. The instances must be deleted with destroy().
+       * @param constructor: Index of the constructor (see constructorIndex())
+       * @throws UndefinedInstance if an instance is nullptr after the constructor is called. */
+      std::tuple<Classes * ...> construct(size_t constructor)
+      {
+         ensureConstructor();
+
+         std::tuple<Classes * ...> instances;
+         std::apply(set_instances_to_null, instances);
+
+         std::apply(m_constructors.at(constructor), instances);
+
+         std::apply([&](Classes * ... instances) {
+            if (instances_are_nullptr(instances...)) {
+               destruct(instances...);
+               throw UndefinedInstance(m_constructorNames[constructor]);
+            }
+         }, instances);
+
+         return instances;
+      }
+
+      /** Delete instances, constructed with construct(), and set them to nullptr. */
+      void destroy(std::tuple<Classes * ...> & instances)
+      {
+         std::apply(destruct, instances);
+         std::apply(set_instances_to_null, instances);
+      }
+
+      /** Run and evaluate all tests. */
+      void run()
+      {
+         ensureConstructor();
+
+         for (size_t i = 0; i < m_constructors.size(); i++) {
+            m_currentConstructor = i;
+            for (size_t j = 0; j < m_tests.size(); j++) {
+               m_instanceTuple = construct(i);
 
                std::apply([&](Classes * ... instances) {
                   m_tests[j]->run(*instances...);
@@ -126,7 +205,7 @@ namespace fbtt {
                // push back result of test
                m_testResults.push_back(m_tests[j]->result());
 
-               std::apply(destruct, m_instanceTuple);
+               destroy(m_instanceTuple);
             }
          }
          finished = true;
@@ -205,6 +284,11 @@ namespace fbtt {
                   << TerminalColor::YELLOW << TerminalStyle::BOLD
                   << res.failString;
             }
+
+            if (!res.details.empty()) {
+               os << TerminalColor::GRAY << TerminalStyle::NONE
+                  << '\n' << res.details;
+            }
             os << '\n' << TerminalColor::WHITE << TerminalStyle::NONE;
          }
       }
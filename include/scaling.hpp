@@ -0,0 +1,253 @@
+#pragma once
+
+#include "test.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <barrier>
+#include <exception>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace fbtt {
+   /** @returns The cores the process may run on: the affinity mask of the process on linux (e.g. restricted by taskset or a cpuset), otherwise every core. */
+   std::vector<int> allowedCores()
+   {
+      std::vector<int> cores;
+   #ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0) {
+         for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set))
+               cores.push_back(cpu);
+      }
+   #endif
+      if (cores.empty()) {
+         for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+            cores.push_back(cpu);
+      }
+      return cores;
+   }
+
+   /** Options for a scaling benchmark (see MultiTest::addScalingBenchmark()).
+    * @param maxThreads: Largest number of threads. Threads are doubled from 1 up to this number. Defaults to the number of cores the process may run on (see allowedCores()).
+    * @param operations: Total number of calls of the body for every thread count. Split evenly between the threads. At least 1.
+    * @param samples: Number of timed runs for every thread count. The median is used.
+    * @param minEfficiency: Fail, if parallel efficiency at maxThreads is below this fraction (e.g. 0.7). Defaults to 0 (never fail).
+    * @param pinThreads: Pin thread i to the i'th core the process may run on (only on linux). */
+   struct ScalingOptions {
+      size_t maxThreads = allowedCores().size();
+      size_t operations = 1 << 20;
+      size_t samples = 3;
+      double minEfficiency = 0.0;
+      bool pinThreads = true;
+   };
+
+   /** Measurement of a scaling benchmark for a single thread count.
+    * @param throughput: Calls of the body per second
+    * @param speedup: Throughput relative to the throughput with a single thread
+    * @param efficiency: Speedup divided by number of threads */
+   struct ScalingPoint {
+      size_t threads;
+      double seconds;
+      double throughput;
+      double speedup;
+      double efficiency;
+   };
+
+   /** @returns The thread counts 1, 2, 4, ... up to maxThreads. maxThreads is always included. */
+   std::vector<size_t> scalingThreadCounts(size_t maxThreads)
+   {
+      std::vector<size_t> counts;
+      for (size_t n = 1; n < maxThreads; n *= 2)
+         counts.push_back(n);
+      counts.push_back(std::max<size_t>(maxThreads, 1));
+      return counts;
+   }
+
+   /** Benchmark, which runs a body on the same instances with an increasing number of threads,
+    * and reports throughput, speedup and parallel efficiency for every thread count in the test result.
+    * @param run(): Run benchmark on instances
+    * @param result(): Return result of benchmark : TestResult
+    * @param points(): Measurements of last run */
+   template <typename ... TestArgs>
+   class ScalingBenchmark : public AbstractTest<TestArgs...> {
+      const std::function<void(TestArgs...)> m_function;
+      const std::string m_name;
+      const ScalingOptions m_options;
+
+      std::vector<ScalingPoint> m_points;
+      std::string m_failureString = "";
+      TestResult::Status m_statusCode = TestResult::Status::NOT_RUN;
+
+      std::vector<int> m_cores; // cores the process may run on
+      size_t m_pinFailures = 0;
+
+      size_t operations() const { return std::max<size_t>(m_options.operations, 1); };
+
+      // @returns false, if the thread could not be pinned
+      static bool pinToCore(std::thread & thread, int core)
+      {
+      #ifdef __linux__
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET(core, &set);
+         return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set) == 0;
+      #else
+         return true;
+      #endif
+      }
+
+      // time operations() calls of the function, split between the given number of threads
+      double timeRun(size_t threadCount, TestArgs ... args)
+      {
+         // the clock starts in the completion of the barrier, before any thread is released
+         Clock::time_point begin;
+         std::barrier start { static_cast<std::ptrdiff_t>(threadCount + 1), [&]() noexcept { begin = Clock::now(); } };
+         std::vector<std::exception_ptr> errors(threadCount);
+         std::vector<std::thread> threads;
+
+         for (size_t t = 0; t < threadCount; t++) {
+            size_t calls = operations() / threadCount
+               + (t < operations() % threadCount ? 1 : 0);
+
+            threads.emplace_back([&, t, calls]() {
+               start.arrive_and_wait();
+               try {
+                  for (size_t i = 0; i < calls; i++)
+                     m_function(args...);
+               } catch (...) {
+                  errors[t] = std::current_exception();
+               }
+            });
+
+            if (m_options.pinThreads && !pinToCore(threads.back(), m_cores[t % m_cores.size()]))
+               m_pinFailures++;
+         }
+
+         start.arrive_and_wait();
+         for (std::thread & thread : threads)
+            thread.join();
+         double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+         for (std::exception_ptr & error : errors)
+            if (error)
+               std::rethrow_exception(error);
+
+         return seconds;
+      }
+
+      static std::string formatThroughput(double perSecond)
+      {
+         const char * units[] = { "", "k", "M", "G" };
+         size_t unit = 0;
+         while (unit < 3 && perSecond >= 1000.0) {
+            perSecond /= 1000.0;
+            unit++;
+         }
+
+         std::ostringstream os;
+         os << std::fixed << std::setprecision(2) << perSecond << ' ' << units[unit] << "ops/s";
+         return os.str();
+      }
+
+      std::string table() const
+      {
+         std::ostringstream os;
+         os << "      " << std::setw(8) << "threads"
+            << std::setw(16) << "throughput"
+            << std::setw(10) << "speedup"
+            << std::setw(12) << "efficiency";
+
+         for (const ScalingPoint & p : m_points) {
+            os << "\n      " << std::setw(8) << p.threads
+               << std::setw(16) << formatThroughput(p.throughput)
+               << std::setw(9) << std::fixed << std::setprecision(2) << p.speedup << 'x'
+               << std::setw(11) << std::setprecision(1) << p.efficiency * 100.0 << '%';
+         }
+
+         size_t maxThreads = m_points.back().threads;
+         if (maxThreads > m_cores.size())
+            os << "\n      warning: oversubscribed, " << maxThreads << " threads on "
+               << m_cores.size() << " available cores";
+         if (m_pinFailures > 0)
+            os << "\n      warning: pinning failed for " << m_pinFailures << " threads";
+         return os.str();
+      }
+
+   public:
+      /** Construct a new scaling benchmark.
+       * @param name: Name of benchmark
+       * @param function: Function, which is called options.operations times for every thread count. Must be thread safe.
+       * @param options: Options for the benchmark */
+      ScalingBenchmark(const std::string & name, std::function<void(TestArgs...)> function, const ScalingOptions & options = { })
+         : m_function { function },
+           m_name { name },
+           m_options { options } { };
+
+      /** Run benchmark
+       * @param args... Arguments to call the function with, from every thread. */
+      virtual void run(TestArgs ... args) noexcept
+      {
+         m_points.clear();
+         m_cores = allowedCores();
+         m_pinFailures = 0;
+         try {
+            // untimed warm-up, so the single thread baseline isn't measured cold
+            timeRun(1, args...);
+
+            for (size_t threads : scalingThreadCounts(m_options.maxThreads)) {
+               std::vector<double> samples;
+               for (size_t i = 0; i < std::max<size_t>(m_options.samples, 1); i++)
+                  samples.push_back(timeRun(threads, args...));
+
+               double seconds = median(samples);
+               double throughput = operations() / seconds;
+               double speedup = m_points.empty() ? 1.0 : throughput / m_points.front().throughput;
+               m_points.push_back({ threads, seconds, throughput, speedup, speedup / threads });
+            }
+
+            const ScalingPoint & top = m_points.back();
+            if (top.efficiency < m_options.minEfficiency) {
+               std::ostringstream os;
+               os << std::fixed << std::setprecision(1)
+                  << "parallel efficiency at " << top.threads << " threads is "
+                  << top.efficiency * 100.0 << "%, expected at least "
+                  << m_options.minEfficiency * 100.0 << "%";
+               m_statusCode = TestResult::Status::ASSERTION_FAILURE;
+               m_failureString = os.str();
+            } else {
+               m_statusCode = TestResult::Status::PASSED;
+            }
+         } catch (AssertionFailure & e) {
+            m_statusCode = TestResult::Status::ASSERTION_FAILURE;
+            m_failureString = std::string(e.what());
+         } catch (std::exception & e) {
+            m_statusCode = TestResult::Status::UNEXPECTED_ERROR;
+            m_failureString = "benchmark threw error with message: " + std::string(e.what());
+         }
+      }
+
+      /** @returns Name of benchmark */
+      virtual const std::string & name() const { return m_name; };
+
+      /** @returns Measurements of the last run, one for every thread count */
+      const std::vector<ScalingPoint> & points() const { return m_points; };
+
+      /** @returns Result of benchmark. The details contain a table of the measurements. */
+      virtual TestResult result() const
+      {
+         return { name(), m_statusCode, m_failureString, m_points.empty() ? "" : table() };
+      }
+
+      virtual ~ScalingBenchmark() { };
+   };
+};
@@ -11,6 +11,7 @@ namespace fbtt {
    /** Container for result of a test. Gotten with Test::Result
     * @param testName: Name of test
     * @param failString: Error message for test
+    * @param details: Additional output of the test, e.g. measurements of a benchmark
     * @param testFailed(): True, if test failed, false otherwise
     * @param status(): String indicating the status of the test
     * @param report(): Combined information about the testresult
@@ -28,6 +29,7 @@ namespace fbtt {
       const std::string testName; // name of the test, this is the result for
       const Status statusCode; // status code for test 
       const std::string failString = ""; // reason for potential test failure
+      const std::string details = ""; // additional output, e.g. measurements of a benchmark
 
       bool testFailed() const;
       std::string status() const;
@@ -168,7 +170,8 @@ std::string TestResult::status() const
    /** @returns Formatted report of test run. */
    std::string TestResult::report() const
    {
-      return "TEST \"" + testName + "\" " + (testFailed() ? "✕" : "✓") + " " + status() + ". " + (testFailed() ? "Reason: " + failString : "");
+      return "TEST \"" + testName + "\" " + (testFailed() ? "✕" : "✓") + " " + status() + ". " + (testFailed() ? "Reason: " + failString : "")
+         + (details.empty() ? "" : "\n" + details);
    }
 
    std::ostream & operator << (std::ostream & os, const TestResult & res)
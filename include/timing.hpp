@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "functionConcepts.hpp"
+
+namespace fbtt {
+   using Clock = std::chrono::steady_clock;
+   using Nanoseconds = std::chrono::duration<double, std::nano>;
+
+   /** Options for timing a function with fbtt::measure().
+    * @param samples: Number of timed samples. The median of the samples is used.
+    * @param minSampleTime: Minimum measured duration of a single sample. Calls are batched until this duration is reached.
+    * @param maxSampleTime: Stop growing the sample, when making the inputs and running a sample takes longer than this.
+    * @param maxBatch: Upper bound on the number of inputs made at once.
+    * @param maxBatchBytes: Upper bound on the memory held by the inputs made at once (estimated with fbtt::inputBytes()).
+    *    Inputs made at once should fit in the cache, or the timed calls get slower, the larger the inputs are. */
+   struct TimingOptions {
+      size_t samples = 7;
+      Nanoseconds minSampleTime = std::chrono::microseconds(500);
+      Nanoseconds maxSampleTime = std::chrono::milliseconds(50);
+      size_t maxBatch = 1 << 12;
+      size_t maxBatchBytes = 1 << 22;
+   };
+
+   /** Result of fbtt::measure(). All times are in nanoseconds per call.
+    * @param median: Median time of the samples
+    * @param min: Fastest sample
+    * @param batch: Number of inputs made at once. A sample repeats the batch, until it is long enough. */
+   struct Measurement {
+      double median = 0.0;
+      double min = 0.0;
+      size_t batch = 1;
+   };
+
+   /** @returns Estimated memory held by an input: the size of the object, and the elements of containers. */
+   template <typename T>
+   size_t inputBytes(const T & input)
+   {
+      if constexpr (requires { typename T::value_type; input.size(); })
+         return sizeof(T) + input.size() * sizeof(typename T::value_type);
+      else
+         return sizeof(T);
+   }
+
+   /** Prevent the compiler from optimizing away the computation of value. */
+   template <typename T>
+   void doNotOptimize(T & value)
+   {
+   #if defined(__GNUC__) || defined(__clang__)
+      asm volatile("" : : "r,m"(value) : "memory");
+   #else
+      volatile auto * p = &value;
+      (void) p;
+   #endif
+   }
+
+   /** @returns The median of values. values must not be empty. */
+   double median(std::vector<double> values)
+   {
+      std::sort(values.begin(), values.end());
+      size_t mid = values.size() / 2;
+      if (values.size() % 2 == 0)
+         return (values[mid - 1] + values[mid]) / 2.0;
+      return values[mid];
+   }
+
+   /** @returns Median duration of an empty timed region, which is subtracted from every timed batch. */
+   Nanoseconds clockOverhead()
+   {
+      static const Nanoseconds overhead = []() {
+         std::vector<double> durations;
+         for (size_t i = 0; i < 101; i++) {
+            auto start = Clock::now();
+            auto end = Clock::now();
+            durations.push_back(Nanoseconds(end - start).count());
+         }
+         return Nanoseconds(median(durations));
+      }();
+      return overhead;
+   }
+
+   /** Time calls of body with input made by setup. Setup is not part of the measured time.
+    * Every call of body gets a fresh input: a sample makes a batch of inputs first, and then times body on each of them.
+    * The batch is limited by options.maxBatch and options.maxBatchBytes, so the inputs of a batch stay in the cache.
+    * Batches are repeated, until the sample is at least options.minSampleTime long, and the median of options.samples samples is used.
+    * @param setup: Function with signature Input(), which produces the input for a single call
+    * @param body: Function with signature void(Input &), which is timed
+    * @returns The measurement in nanoseconds per call of body */
+   template <typename Setup, typename Body>
+      requires CallableWith<Setup>
+   Measurement measure(Setup setup, Body body, const TimingOptions & options = { })
+   {
+      using Input = decltype(setup());
+
+      // returns the measured time without the clock overhead, and the time including making the inputs
+      auto timeBatch = [&](size_t batch) -> std::pair<Nanoseconds, Nanoseconds> {
+         auto setupStart = Clock::now();
+         std::vector<Input> inputs;
+         inputs.reserve(batch);
+         for (size_t i = 0; i < batch; i++)
+            inputs.push_back(setup());
+
+         auto start = Clock::now();
+         for (Input & input : inputs) {
+            body(input);
+            doNotOptimize(input);
+         }
+         auto end = Clock::now();
+         return { std::max(Nanoseconds(end - start) - clockOverhead(), Nanoseconds(0)), end - setupStart };
+      };
+
+      // a sample repeats the batch, until it is long enough to be measured reliably. returns nanoseconds per call
+      auto timeSample = [&](size_t batch) -> double {
+         Nanoseconds measured { 0 }, total { 0 };
+         size_t calls = 0;
+         do {
+            auto [m, t] = timeBatch(batch);
+            measured += m;
+            total += t;
+            calls += batch;
+         } while (measured < options.minSampleTime && total < options.maxSampleTime);
+         return measured.count() / calls;
+      };
+
+      size_t batchBytes = std::max<size_t>(inputBytes(setup()), 1);
+      size_t batch = std::clamp<size_t>(options.maxBatchBytes / batchBytes, 1, std::max<size_t>(options.maxBatch, 1));
+
+      timeSample(batch); // untimed warm-up
+
+      std::vector<double> samples;
+      for (size_t i = 0; i < std::max<size_t>(options.samples, 1); i++)
+         samples.push_back(timeSample(batch));
+
+      return { median(samples), *std::min_element(samples.begin(), samples.end()), batch };
+   }
+
+   /** @returns Human readable string for a duration given in nanoseconds, e.g. "12.3 us". */
+   std::string formatNanoseconds(double ns)
+   {
+      const char * units[] = { "ns", "us", "ms", "s" };
+      size_t unit = 0;
+      while (unit < 3 && ns >= 1000.0) {
+         ns /= 1000.0;
+         unit++;
+      }
+
+      std::ostringstream os;
+      os << std::fixed << std::setprecision(ns < 10.0 ? 2 : 1) << ns << ' ' << units[unit];
+      return os.str();
+   }
+};